@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
 #include "sparse_matrix.h"
+#include "ooc_sparse_matrix.h"
 
 const int def_val = -777;
 
@@ -105,3 +111,329 @@ TEST_F(SparseMatrixTest, TestMatrixFreeUnused)
         EXPECT_EQ(--nr, sm.nrows());
     }
 }
+
+TEST_F(SparseMatrixTest, TestCursorRowMajor)
+{
+    auto c = sm.get_cursor();
+    for (int i = 0; i < 20; ++i)
+        for (int j = 0; j < 20; j += 1 + i % 3)
+            c.set(i, j, i * 100 + j);
+
+    for (int i = 0; i < 20; ++i)
+        for (int j = 0; j < 20; ++j)
+        {
+            auto expected = (j % (1 + i % 3)) ? def_val : i * 100 + j;
+            EXPECT_EQ(c.get(i, j), expected);
+            EXPECT_EQ(sm[i][j], expected);
+        }
+    // backward and far jumps
+    EXPECT_EQ(c.get(0, 0), 0);
+    EXPECT_EQ(c.get(19, 17), def_val);
+    EXPECT_EQ(c.get(1000, 1000), def_val);
+    EXPECT_EQ(c.get(3, 0), 300);
+}
+
+TEST_F(SparseMatrixTest, TestCursorNegativeIndexes)
+{
+    sm[-1][-1] = 11;
+    sm[-1][2] = 12;
+    auto c = sm.get_cursor();
+    EXPECT_EQ(c.get(-1, -1), 11);
+    EXPECT_EQ(c.get(-1, 2), 12);
+    c.reset();
+    EXPECT_EQ(c.get(-1, 0), def_val);
+    c.set(-2, -1, 21);
+    EXPECT_EQ(sm[-2][-1], 21);
+    c.set(-1, -1, def_val);
+    EXPECT_EQ(sm[-1][-1], def_val);
+    EXPECT_EQ(sm.size(), 2);
+}
+
+TEST_F(SparseMatrixTest, TestCursorStencilAndFree)
+{
+    for (int i = 0; i <= 9; ++i)
+    {
+        sm[i][i] = i + 1;
+        sm[i][9 - i] = 10 - i;
+    }
+    auto sz = sm.size();
+    auto c = sm.get_cursor();
+    for (int i = 1; i < 9; ++i)
+        for (int j = 1; j < 9; ++j)
+        {
+            auto s = c.get(i - 1, j) + c.get(i + 1, j) + c.get(i, j - 1) + c.get(i, j + 1);
+            EXPECT_EQ(s, sm[i - 1][j] + sm[i + 1][j] + sm[i][j - 1] + sm[i][j + 1]);
+        }
+
+    for (int i = 9; i >= 0; --i)
+    {
+        c.set(i, 9 - i, def_val);
+        c.set(i, i, def_val);
+        c.set(i, i, def_val);
+        sz -= (i == 9 - i) ? 1 : 2;
+        EXPECT_EQ(sm.size(), sz);
+        EXPECT_EQ(sm.nrows(), i);
+    }
+    c.set(5, 5, 55);
+    EXPECT_EQ(sm[5][5], 55);
+    EXPECT_EQ(sm.nrows(), 1);
+}
+
+TEST_F(SparseMatrixTest, TestValueIndexQueries)
+{
+    // the queries give the same results with the value index and with the scan
+    for (bool indexed : {false, true})
+    {
+        sm.clear();
+        sm.disable_value_index();
+        for (int i = 0; i <= 9; ++i)
+            for (int j = 0; j <= 9; ++j)
+                sm[i][j] = i * 10 + j;
+        if (indexed) // build the index from the existing cells
+            sm.enable_value_index();
+        sm[5][5] = def_val;
+
+        auto top = sm.top_k(3);
+        ASSERT_EQ(top.size(), 3u);
+        EXPECT_EQ(top[0].v, 99);
+        EXPECT_EQ(top[1].v, 98);
+        EXPECT_EQ(top[2].i, 9);
+        EXPECT_EQ(top[2].j, 7);
+
+        auto range = sm.range_by_value(50, 59);
+        ASSERT_EQ(range.size(), 9u);
+        for (size_t k = 1; k < range.size(); ++k)
+            EXPECT_LT(range[k - 1].v, range[k].v);
+
+        sm[0][0] = 1000;
+        sm[9][9] = def_val;
+        sm[5][0] = sm[5][1] = 500;
+        top = sm.top_k(4);
+        ASSERT_EQ(top.size(), 4u);
+        EXPECT_EQ(top[0].v, 1000);
+        EXPECT_EQ(top[1].v, 500);
+        EXPECT_EQ(top[1].j, 1);
+        EXPECT_EQ(top[2].v, 500);
+        EXPECT_EQ(top[3].v, 98);
+        EXPECT_EQ(sm.range_by_value(50, 59).size(), 7u);
+
+        auto row = sm.row_top_k(5, 2);
+        ASSERT_EQ(row.size(), 2u);
+        EXPECT_EQ(row[0].v, 500);
+        EXPECT_EQ(row[1].v, 500);
+        EXPECT_EQ(sm.row_top_k(5, 100).size(), 9u);
+        EXPECT_TRUE(sm.row_top_k(100, 1).empty());
+        EXPECT_TRUE(sm.top_k(0).empty());
+        EXPECT_EQ(sm.top_k(1000).size(), static_cast<size_t>(sm.size()));
+        // queries never turn the index on
+        EXPECT_EQ(sm.has_value_index(), indexed);
+    }
+}
+
+TEST_F(SparseMatrixTest, TestValueIndexCursorAndClear)
+{
+    sm.enable_value_index();
+    auto c = sm.get_cursor();
+    for (int i = 0; i <= 9; ++i)
+        c.set(i, 9 - i, i);
+    c.set(3, 6, 33);
+    c.set(4, 5, def_val);
+
+    auto range = sm.range_by_value(3, 33);
+    ASSERT_EQ(range.size(), 6u);
+    EXPECT_EQ(range.front().v, 5);
+    EXPECT_EQ(range.back().i, 3);
+    EXPECT_EQ(range.back().v, 33);
+    EXPECT_TRUE(sm.row_top_k(4, 1).empty());
+
+    sm.clear();
+    EXPECT_TRUE(sm.top_k(10).empty());
+    sm.disable_value_index();
+    sm[1][1] = 11;
+    EXPECT_EQ(sm.top_k(10).size(), 1u);
+    EXPECT_FALSE(sm.has_value_index());
+}
+
+class OocSparseMatrixTest : public ::testing::Test
+{
+protected:
+    using matrix_type = OocSparseMatrix<int, def_val>;
+
+    // every test runs in its own process under ctest, so each one needs its own spill file
+    static std::string spill_path()
+    {
+        auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+        return ::testing::TempDir() + info->test_suite_name() + "." + info->name() + ".spill";
+    }
+
+    // room for the index of 64 spilled rows and 4 resident rows of 8 cells
+    static constexpr size_t budget = 64 * matrix_type::index_entry_bytes + 4 * (matrix_type::row_bytes + 8 * matrix_type::cell_bytes);
+
+    matrix_type om{spill_path(), budget, 4};
+
+    void fill(int nrows, int ncols)
+    {
+        for (int i = 0; i < nrows; ++i)
+            for (int j = 0; j < ncols; ++j)
+                om[i][j * 3] = i * 1000 + j;
+    }
+};
+
+TEST_F(OocSparseMatrixTest, TestSpillAndFault)
+{
+    fill(64, 8);
+    EXPECT_EQ(om.size(), 64 * 8);
+    EXPECT_EQ(om.nrows(), 64);
+    EXPECT_LE(om.resident_bytes(), om.budget());
+    EXPECT_LE(om.index_bytes(), om.nrows() * matrix_type::index_entry_bytes);
+    EXPECT_GT(om.index_bytes(), 0u);
+    EXPECT_GT(om.stats().evictions, 0u);
+
+    for (int i = 63; i >= 0; --i)
+    {
+        for (int j = 0; j < 8; ++j)
+        {
+            EXPECT_EQ(om[i][j * 3], i * 1000 + j);
+            EXPECT_EQ(om[i][j * 3 + 1], def_val);
+        }
+    }
+    EXPECT_GT(om.stats().misses, 0u);
+    EXPECT_LE(om.resident_bytes(), om.budget());
+    EXPECT_EQ(om[100][0], def_val);
+    EXPECT_EQ(om.nrows(), 64);
+}
+
+TEST_F(OocSparseMatrixTest, TestRewriteSpilledRows)
+{
+    fill(16, 8);
+    // grow every row, so the records are appended, then shrink them, so they are rewritten in place
+    for (int i = 0; i < 16; ++i)
+        om[i][1] = -i;
+    for (int i = 0; i < 16; ++i)
+        for (int j = 0; j < 4; ++j)
+            om[i][j * 3] = def_val;
+    // free some rows completely
+    for (int i = 0; i < 16; i += 2)
+        for (int j = 4; j < 8; ++j)
+            om[i][j * 3] = def_val;
+    for (int i = 0; i < 16; i += 2)
+        om[i][1] = def_val;
+
+    EXPECT_EQ(om.nrows(), 8);
+    EXPECT_EQ(om.size(), 8 * 5);
+    EXPECT_GT(om.dead_spill_bytes(), 0u);
+    for (int i = 1; i < 16; i += 2)
+    {
+        EXPECT_EQ(om[i][1], -i);
+        for (int j = 0; j < 8; ++j)
+            EXPECT_EQ(om[i][j * 3], j < 4 ? def_val : i * 1000 + j);
+    }
+}
+
+TEST_F(OocSparseMatrixTest, TestColumnMajorFillSpillSize)
+{
+    // every row grows by one cell per pass and is evicted in between
+    for (int j = 0; j < 32; ++j)
+        for (int i = 0; i < 64; ++i)
+            om[i][j] = i * 1000 + j;
+
+    EXPECT_EQ(om.size(), 64 * 32);
+    // record slack doubles live records at most, and compaction keeps superseded ones within a half of the file
+    size_t live_bytes = om.nrows() * 2 * sizeof(int32_t) + om.size() * (sizeof(int32_t) + sizeof(int));
+    EXPECT_LE(om.spill_bytes(), 4 * live_bytes);
+    EXPECT_LE(om.dead_spill_bytes(), om.spill_bytes() / 2);
+
+    for (int i = 0; i < 64; ++i)
+        for (int j = 0; j < 32; ++j)
+            EXPECT_EQ(om[i][j], i * 1000 + j);
+}
+
+TEST_F(OocSparseMatrixTest, TestIteratorPrefetch)
+{
+    fill(64, 8);
+    om.reset_stats();
+
+    auto sz = om.size();
+    int prev_i = -1, prev_j = -1;
+    for (auto c : om)
+    {
+        EXPECT_TRUE(c.i > prev_i || (c.i == prev_i && c.j > prev_j));
+        EXPECT_EQ(c.v, c.i * 1000 + c.j / 3);
+        EXPECT_LE(om.resident_bytes(), om.budget());
+        prev_i = c.i;
+        prev_j = c.j;
+        --sz;
+    }
+    EXPECT_EQ(sz, 0);
+    // every row is counted once, however many cells it has
+    auto &st = om.stats();
+    EXPECT_EQ(st.hits + st.misses + st.prefetched, 64u);
+    EXPECT_LT(st.hit_rate(), 0.25);
+    EXPECT_GT(om.stats().prefetched, 0u);
+    // records of the rows filled in sequence are adjacent, so one read serves several rows
+    EXPECT_LT(om.stats().reads, om.stats().prefetched + om.stats().misses);
+    EXPECT_LE(om.resident_bytes(), om.budget());
+}
+
+TEST_F(OocSparseMatrixTest, TestNegativeIndexes)
+{
+    om[-5][0] = 1;
+    om[3][0] = 2;
+    om[-1][-1] = 3;
+    EXPECT_EQ(om[-5][0], 1);
+    EXPECT_EQ(om[-1][-1], 3);
+
+    std::vector<std::tuple<int, int, int>> visited;
+    for (auto c : om)
+        visited.emplace_back(c.i, c.j, c.v);
+    std::vector<std::tuple<int, int, int>> expected{{-5, 0, 1}, {-1, -1, 3}, {3, 0, 2}};
+    EXPECT_EQ(visited, expected);
+
+    // the same with the rows spilled
+    fill(64, 8);
+    int n = 0;
+    for (auto c : om)
+    {
+        EXPECT_EQ(om[c.i][c.j], c.v);
+        ++n;
+    }
+    EXPECT_EQ(n, om.size());
+    EXPECT_EQ(om[-5][0], 1);
+}
+
+TEST_F(OocSparseMatrixTest, TestRecoverAfterIOError)
+{
+    fill(64, 8);
+    // faulting spilled rows in evicts and writes the modified rows, and flushes the pending writes
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(om[i][0], i * 1000);
+    // lose the spilled records behind the matrix's back, so reading them fails
+    std::ofstream(spill_path(), std::ios::trunc);
+    EXPECT_THROW(static_cast<void>(static_cast<int>(om[20][0])), std::runtime_error);
+    EXPECT_EQ(om.nrows(), 64);
+    EXPECT_EQ(om[9][3], 9001);
+
+    // the spill file is still usable: new rows are spilled and faulted back
+    for (int i = 100; i < 164; ++i)
+        for (int j = 0; j < 8; ++j)
+            om[i][j] = i * 1000 + j;
+    for (int i = 100; i < 164; ++i)
+        for (int j = 0; j < 8; ++j)
+            EXPECT_EQ(om[i][j], i * 1000 + j);
+}
+
+TEST_F(OocSparseMatrixTest, TestHitRate)
+{
+    fill(2, 8);
+    om.reset_stats();
+    for (int k = 0; k < 10; ++k)
+        EXPECT_EQ(om[1][3], 1001);
+    EXPECT_EQ(om.stats().misses, 0u);
+    EXPECT_EQ(om.stats().hits, 1u);
+    EXPECT_DOUBLE_EQ(om.stats().hit_rate(), 1.0);
+
+    om.clear();
+    EXPECT_EQ(om.size(), 0);
+    EXPECT_EQ(om.spill_bytes(), 0u);
+    EXPECT_TRUE(om.begin() == om.end());
+}
@@ -0,0 +1,863 @@
+#pragma once
+
+/**
+ * @file ooc_sparse_matrix.h
+ * @brief OocSparseMatrix class implementation
+ * @date October 2026
+ * @details
+ * Implements OocSparseMatrix - an out-of-core variant of SparseMatrix for the matrices that do not fit into RAM.\n
+ * Rows are kept in memory while they fit into a configurable memory budget. Cold rows are chosen by the CLOCK
+ * algorithm and spilled to a local scratch file in a compact sorted format; they are faulted back on access.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sparse_matrix.h"
+
+/**
+ * @brief Sparse matrix that keeps hot rows in memory and spills cold rows to disk.
+ *
+ * @tparam V cell type.
+ * @tparam def_val default value for cells.
+ *
+ * @details
+ * Resident rows are stored in std::map the same way SparseMatrix does. When the estimated memory footprint
+ * of the matrix exceeds the budget, rows are evicted by the CLOCK (second chance) algorithm.
+ * The footprint includes resident rows and cells, the read-ahead buffer and the in-memory index of the spilled records.
+ * The index can not be evicted, so if it alone outgrows the budget only the row being accessed stays resident.\n
+ * An evicted row is written to the spill file as a record `[row][count][col, value]...` with cells sorted by column.
+ * A row that was not modified since it has been loaded is dropped without any I/O, as its record is still valid.
+ * A modified row is rewritten in place if it still fits into its record, or appended to the end of the file otherwise;
+ * an appended record has room for a power of two cells, so a growing row is not moved on every eviction.
+ * When superseded records take more than a half of the file, live records are compacted to its beginning.\n
+ * Range iteration prefetches the next rows in sequence and reads the adjacent records with a single read.\n
+ * Row and column indexes may take any `int` values, including negative ones, like in SparseMatrix.
+ */
+template <typename V, V def_val = 0>
+class OocSparseMatrix
+{
+    static_assert(std::is_trivially_copyable<V>::value, "cell type should be trivially copyable to be spilled");
+
+    /**
+     * @brief Resident row.
+     */
+    struct row_type
+    {
+        typename SparseVector<V, def_val>::vector_data_type data; ///< cells of the row
+        bool referenced{true};                                    ///< CLOCK reference bit
+        bool dirty{false};                                        ///< row differs from its spilled record (if any)
+    };
+
+    /**
+     * @brief Location of a spilled row record.
+     */
+    struct extent_type
+    {
+        std::streamoff offset{0}; ///< record offset in the spill file
+        uint32_t count{0};        ///< number of cells in the record
+        uint32_t capacity{0};     ///< number of cells the record has room for
+    };
+
+    using rows_type = std::map<int, row_type>;
+    using cell_type = std::pair<int, V>;
+    using readahead_type = std::map<int, std::vector<cell_type>>;
+
+    /** @brief Size of map node links and color. */
+    static constexpr size_t node_bytes = 4 * sizeof(void *);
+
+public:
+    /** @brief Estimated memory footprint of one resident cell: map node with its links and color. */
+    static constexpr size_t cell_bytes = sizeof(std::pair<const int, V>) + node_bytes;
+
+    /** @brief Estimated memory footprint of one resident row besides its cells: map node with the row map header. */
+    static constexpr size_t row_bytes = sizeof(typename rows_type::value_type) + node_bytes;
+
+    /** @brief Estimated memory footprint of one spilled row in the index of the spill file records. */
+    static constexpr size_t index_entry_bytes = sizeof(std::pair<const int, extent_type>) + node_bytes;
+
+    /** @brief Estimated memory footprint of one prefetched row besides its cells. */
+    static constexpr size_t readahead_row_bytes = sizeof(typename readahead_type::value_type) + node_bytes;
+
+    /** @brief Default number of rows read ahead by the range iteration. */
+    static constexpr size_t default_prefetch_rows = 16;
+
+    /**
+     * @brief Counters for the memory budget sizing.
+     * @details Row accesses are counted when the access moves to another row, so consecutive accesses
+     * to the cells of the same row, like in a row-major loop or the iteration, count as one.
+     */
+    struct stats_type
+    {
+        size_t hits{0};          ///< row accesses served from memory
+        size_t misses{0};        ///< row accesses that had to read the row from disk
+        size_t prefetched{0};    ///< row accesses served from the read-ahead buffer
+        size_t evictions{0};     ///< rows evicted from memory
+        size_t reads{0};         ///< read operations on the spill file
+        size_t writes{0};        ///< write operations on the spill file
+        size_t bytes_read{0};    ///< bytes read from the spill file
+        size_t bytes_written{0}; ///< bytes written to the spill file
+
+        /**
+         * @brief Share of row accesses served from memory without any I/O.
+         * @returns Value in [0, 1], or 1 if there were no accesses yet.
+         */
+        double hit_rate() const
+        {
+            auto total = hits + misses + prefetched;
+            return total ? static_cast<double>(hits) / total : 1.0;
+        }
+    };
+
+    /**
+     * @brief Structure for storing matrix cell indexes and value.
+     */
+    struct ret_type
+    {
+        int i, j;
+        V v;
+    };
+
+    /**
+     * @brief Constructor.
+     * @param path Spill file path. The file is truncated on open and removed in destructor.
+     * @param budget Memory budget in bytes (see resident_bytes()).
+     * @param prefetch_rows Number of rows read ahead by the range iteration, 0 disables prefetch.
+     * @throws std::runtime_error if spill file can not be opened.
+     */
+    OocSparseMatrix(const std::string &path, size_t budget, size_t prefetch_rows = default_prefetch_rows)
+        : spill_path{path}, budget_bytes{budget}, prefetch_depth{prefetch_rows}
+    {
+        open_spill();
+    }
+
+    OocSparseMatrix(const OocSparseMatrix &) = delete;
+    OocSparseMatrix &operator=(const OocSparseMatrix &) = delete;
+
+    /**
+     * @brief Destructor.
+     * @details Closes and removes the spill file.
+     */
+    ~OocSparseMatrix()
+    {
+        file.close();
+        std::remove(spill_path.c_str());
+    }
+
+    /**
+     * @brief Proxy for a matrix cell to discern cell write or read.
+     * @details Holds cell indexes only, so the row is looked up (and faulted in if nessesery) on every read or write.
+     * It keeps the proxy valid even if its row has been evicted in between, like in `mx[i1][j1] = mx[i2][j2]`.
+     */
+    class cell_proxy
+    {
+    public:
+        /**
+         * @brief Consructor.
+         * @param pm Pointer to the owner matrix.
+         * @param row, col Cell indexes.
+         */
+        cell_proxy(OocSparseMatrix *pm, int row, int col) : m{pm}, i{row}, j{col} {}
+
+        /**
+         * @brief Cell value assignment operator.
+         * @param v - Cell value to be assingned.
+         * @returns Cell value - the same that was passed as a parameter.
+         */
+        V operator=(const V &v)
+        {
+            m->set_value(i, j, v);
+            return v;
+        }
+
+        /**
+         * @brief Casting proxy type to cell value type operator.
+         * @returns The existing or Default cell value.
+         */
+        operator V() const
+        {
+            return m->get_value(i, j);
+        }
+
+        /**
+         * @brief Assignment from other proxy object, as in a chain of assingnments.
+         * @param rhv - Right-hand proxy object
+         * @returns Reference to **this** proxy object.
+         */
+        cell_proxy &operator=(const cell_proxy &rhv)
+        {
+            if (&rhv != this)
+            {
+                operator=(V(rhv));
+            }
+            return *this;
+        }
+
+    private:
+        OocSparseMatrix *m{nullptr}; ///< owner matrix
+        int i{-1};                   ///< row index
+        int j{-1};                   ///< column index
+    };
+
+    /**
+     * @brief Proxy for a matrix row, returned by OocSparseMatrix::operator[].
+     */
+    class row_proxy
+    {
+    public:
+        /**
+         * @brief Consructor.
+         * @param pm Pointer to the owner matrix.
+         * @param row Row index.
+         */
+        row_proxy(OocSparseMatrix *pm, int row) : m{pm}, i{row} {}
+
+        /**
+         * @brief Indexing a row to get a cell.
+         * @param j Column index.
+         * @returns Proxy for the cell.
+         */
+        cell_proxy operator[](int j) { return cell_proxy(m, i, j); }
+
+    private:
+        OocSparseMatrix *m{nullptr}; ///< owner matrix
+        int i{-1};                   ///< row index
+    };
+
+    /**
+     * @brief Indexing operator for getting a row.
+     * @param i - Row number.
+     * @returns Proxy object for the row. No row is loaded or created at this point.
+     */
+    row_proxy operator[](int i) { return row_proxy(this, i); }
+
+    /**
+     * @brief Reads cell value.
+     * @param i, j - Cell indexes.
+     * @returns Cell value or default value.
+     * @details Faults the row in if it was spilled. Reading an empty row does not create it.
+     */
+    V get_value(int i, int j)
+    {
+        auto r = fetch(i);
+        if (r == rows.end())
+            return def_val;
+        auto it = r->second.data.find(j);
+        return (it != r->second.data.end()) ? it->second : def_val;
+    }
+
+    /**
+     * @brief Writes cell value.
+     * @param i, j - Cell indexes.
+     * @param v - Cell value. Assigning default value frees the cell and the row if it becomes empty.
+     */
+    void set_value(int i, int j, const V &v)
+    {
+        auto r = fetch(i);
+        if (v == def_val)
+        {
+            if (r == rows.end() || !r->second.data.erase(j))
+                return;
+            r->second.dirty = true;
+            --cells;
+            --resident_cells;
+            if (r->second.data.empty())
+                drop_row(r);
+            return;
+        }
+
+        if (r == rows.end())
+        {
+            r = rows.emplace(i, row_type{}).first;
+            ++nonempty_rows;
+        }
+        auto &row = r->second;
+        row.dirty = true;
+        auto [it, inserted] = row.data.emplace(j, v);
+        if (!inserted)
+        {
+            it->second = v;
+            return;
+        }
+        ++cells;
+        ++resident_cells;
+        enforce_budget(i);
+    }
+
+    /**
+     * @brief Returns number of non-empty cells.
+     * @returns Number of non-empty cells in a matrix, both resident and spilled.
+     */
+    int size() const { return cells; }
+
+    /**
+     * @brief Returns number of non-empty rows.
+     * @returns Number of non-empty rows in a matrix, both resident and spilled.
+     */
+    int nrows() const { return nonempty_rows; }
+
+    /**
+     * @brief Erase all the data.
+     * @details Resident rows are dropped and the spill file is truncated. Counters are kept.
+     */
+    void clear()
+    {
+        rows.clear();
+        spilled.clear();
+        readahead.clear();
+        readahead_bytes = 0;
+        cells = resident_cells = 0;
+        nonempty_rows = 0;
+        file_end = dead_bytes = 0;
+        last_row.reset();
+        file.close();
+        open_spill();
+    }
+
+    /** @brief I/O and hit rate counters. */
+    const stats_type &stats() const { return counters; }
+
+    /** @brief Resets I/O and hit rate counters. */
+    void reset_stats()
+    {
+        counters = stats_type{};
+        last_row.reset();
+    }
+
+    /** @brief Memory budget in bytes. */
+    size_t budget() const { return budget_bytes; }
+
+    /** @brief Number of rows currently held in memory. */
+    size_t resident_rows() const { return rows.size(); }
+
+    /**
+     * @brief Estimated memory footprint of the matrix in bytes, that is kept within the budget.
+     * @details Includes resident rows and cells, the read-ahead buffer and index_bytes().
+     */
+    size_t resident_bytes() const
+    {
+        return rows.size() * row_bytes + resident_cells * cell_bytes + readahead_bytes + index_bytes();
+    }
+
+    /** @brief Estimated memory footprint of the index of spilled records in bytes. */
+    size_t index_bytes() const { return spilled.size() * index_entry_bytes; }
+
+    /** @brief Spill file size in bytes. */
+    size_t spill_bytes() const { return file_end; }
+
+    /** @brief Spill file bytes occupied by the records that have been superseded or freed. */
+    size_t dead_spill_bytes() const { return dead_bytes; }
+
+    /**
+     * @brief Forward iterator class to iterate over non-default cells of an OocSparseMatrix.
+     * @details Rows are visited in ascending order and faulted in one by one, so the iteration keeps within the memory budget.
+     * On entering a spilled row the next rows are prefetched. Only indexes are stored, so the iterator stays valid on eviction.
+     */
+    class iterator
+    {
+        OocSparseMatrix *m{nullptr}; ///< matrix to iterate
+        int i{0};                    ///< current row
+        int j{0};                    ///< current column
+        bool valid{false};           ///< iterator addresses a cell, `false` past the end
+
+    public:
+        /** @name Iterator traits: */
+        ///@{
+        using value_type = ret_type;
+        using pointer = ret_type *;
+        using reference = ret_type &;
+        using iterator_category = std::forward_iterator_tag;
+        ///@}
+
+        /**
+         * @brief Constructor of past-the-end iterator.
+         * @param pm Pinter to OocSparseMatrix object to iterate over.
+         */
+        explicit iterator(OocSparseMatrix *pm) : m{pm} {}
+        /**
+         * @brief Constructor.
+         * @param pm Pinter to OocSparseMatrix object to iterate over.
+         * @param row, col Starting row and col indexies to iterate from.
+         */
+        iterator(OocSparseMatrix *pm, int row, int col) : m{pm}, i{row}, j{col}, valid{true} {}
+
+        /**
+         * @brief Iterator comparison, not equal.
+         * @param other Iterator to compare with `this`.
+         * @returns `true` if `this` iterator is not equal to `other`, `false` otherwise.
+         */
+        bool operator!=(const iterator &other) const
+        {
+            return m != other.m || valid != other.valid || (valid && (i != other.i || j != other.j));
+        }
+
+        /**
+         * @brief Iterator comparison, equal.
+         * @param other Iterator to compare with `this`.
+         * @returns `true` if `this` iterator is equal to `other`, `false` otherwise.
+         */
+        bool operator==(const iterator &other) const
+        {
+            return !(*this != other);
+        }
+
+        /**
+         * @brief Indirection operator.
+         * @returns Structure ret_type, contating row index (i), column index (j) and value (v) for the iterator-addressed cell.
+         */
+        ret_type operator*() const
+        {
+            return ret_type{i, j, m->get_value(i, j)};
+        }
+
+        /**
+         * @brief Prefix increment operator.
+         * @details Advances iterator to the next non-empty matrix cell and returns reference to this iterator.\n
+         * If there are no more busy cells, returns past-the-end iterator, that is equal to `end()`.
+         */
+        iterator &operator++()
+        {
+            // the current row has just been read, so it is still resident unless the caller accessed other rows
+            auto r = m->rows.find(i);
+            if (r == m->rows.end())
+                r = m->fetch(i);
+            if (r != m->rows.end())
+            {
+                auto it = r->second.data.upper_bound(j);
+                if (it != r->second.data.end())
+                {
+                    j = it->first;
+                    return *this;
+                }
+            }
+            valid = m->seek_row(m->next_row(i), i, j);
+            return *this;
+        }
+    }; // iterator
+
+    /**
+     * @brief Returns iterator addressing the first non-empty cell.
+     * @returns Iterator addressing the first element in the matrix or the location succeeding an empty matrix.
+     */
+    iterator begin()
+    {
+        int i, j;
+        return seek_row(first_row(), i, j) ? iterator(this, i, j) : end();
+    }
+
+    /**
+     * @brief Returns iterator addressing past the end of matrix.
+     * @returns Past-the-end iterator. If the matrix is empty, then `end() == begin()`.
+     */
+    iterator end() { return iterator(this); }
+
+private:
+    /** @brief Size of a record header: row index and number of cells. */
+    static constexpr size_t header_bytes = sizeof(int32_t) + sizeof(uint32_t);
+    /** @brief Size of a cell in a record: column index and value. */
+    static constexpr size_t record_cell_bytes = sizeof(int32_t) + sizeof(V);
+
+    /** @brief Size of a record with room for `n` cells. */
+    static size_t record_bytes(size_t n) { return header_bytes + n * record_cell_bytes; }
+
+    /** @brief Room for an appended record of `n` cells: `n` rounded up to a power of two. */
+    static uint32_t record_capacity(uint32_t n)
+    {
+        uint32_t c = 1;
+        while (c < n)
+            c <<= 1;
+        return c;
+    }
+
+    /**
+     * @brief Opens (and truncates) the spill file.
+     * @throws std::runtime_error if the file can not be opened.
+     */
+    void open_spill()
+    {
+        file.open(spill_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("OocSparseMatrix: can not open spill file " + spill_path);
+    }
+
+    /**
+     * @brief Finds a row, loading it from the read-ahead buffer or the spill file if nessesery.
+     * @param i - Row index.
+     * @returns Iterator to the resident row or `rows.end()` if the row is empty.
+     */
+    typename rows_type::iterator fetch(int i)
+    {
+        bool same_row = last_row && *last_row == i;
+        last_row = i;
+        auto r = rows.find(i);
+        if (r != rows.end())
+        {
+            if (!same_row)
+                ++counters.hits;
+            r->second.referenced = true;
+            return r;
+        }
+
+        auto s = spilled.find(i);
+        if (s == spilled.end())
+            return rows.end();
+
+        // the row is loaded aside and becomes resident only if it has been read successfully
+        row_type row;
+        auto ra = readahead.find(i);
+        if (ra != readahead.end())
+        {
+            for (auto &c : ra->second)
+                row.data.emplace_hint(row.data.end(), c.first, c.second);
+            readahead_bytes -= readahead_row_bytes + ra->second.size() * sizeof(cell_type);
+            readahead.erase(ra);
+            ++counters.prefetched;
+        }
+        else
+        {
+            std::vector<char> buf(record_bytes(s->second.count));
+            read_at(s->second.offset, buf);
+            decode(buf.data(), row.data);
+            ++counters.misses;
+        }
+        r = rows.emplace(i, std::move(row)).first;
+        resident_cells += r->second.data.size();
+        enforce_budget(i);
+        return r;
+    }
+
+    /**
+     * @brief Removes an empty row both from memory and from the spill file index.
+     * @param r - Iterator to the resident row.
+     */
+    void drop_row(typename rows_type::iterator r)
+    {
+        auto s = spilled.find(r->first);
+        if (s != spilled.end())
+        {
+            dead_bytes += record_bytes(s->second.capacity);
+            spilled.erase(s);
+        }
+        rows.erase(r);
+        --nonempty_rows;
+    }
+
+    /**
+     * @brief Evicts rows by CLOCK algorithm until the matrix fits into the budget.
+     * @param pinned - Row being accessed, that is never evicted, if any.
+     * @param extra - Memory to make room for, in bytes.
+     * @details A row larger than the whole budget stays resident while it is being accessed.
+     */
+    void enforce_budget(std::optional<int> pinned, size_t extra = 0)
+    {
+        while (resident_bytes() + extra > budget_bytes && rows.size() > (pinned ? rows.count(*pinned) : 0))
+        {
+            auto it = rows.lower_bound(clock_hand);
+            for (;;)
+            {
+                if (it == rows.end())
+                    it = rows.begin();
+                if (!pinned || it->first != *pinned)
+                {
+                    if (!it->second.referenced)
+                        break;
+                    it->second.referenced = false;
+                }
+                ++it;
+            }
+            auto next = std::next(it);
+            clock_hand = (next != rows.end()) ? next->first : INT_MIN;
+            evict(it);
+            if (dead_bytes > static_cast<size_t>(file_end) / 2)
+                compact();
+        }
+    }
+
+    /**
+     * @brief Moves live records to the beginning of the spill file, dropping the space of the superseded ones.
+     * @details Records are moved in the file order, so a record is never written over the one that has not been moved yet.
+     * The index entry of a record is updated right after it has been written, so an I/O error leaves the index valid.
+     * The file is not truncated: its tail is reused by the records appended later.
+     */
+    void compact()
+    {
+        std::vector<std::pair<std::streamoff, int>> order;
+        order.reserve(spilled.size());
+        for (auto &s : spilled)
+            order.emplace_back(s.second.offset, s.first);
+        std::sort(order.begin(), order.end());
+
+        std::streamoff end = 0;
+        for (auto &o : order)
+        {
+            auto &ext = spilled[o.second];
+            if (ext.offset != end)
+            {
+                std::vector<char> buf(record_bytes(ext.count));
+                read_at(ext.offset, buf);
+                write_at(end, buf);
+                ext.offset = end;
+            }
+            end += record_bytes(ext.capacity);
+        }
+        file_end = end;
+        dead_bytes = 0;
+    }
+
+    /**
+     * @brief Spills a row if it has been modified, and drops it from memory.
+     * @param r - Iterator to the resident row.
+     */
+    void evict(typename rows_type::iterator r)
+    {
+        auto &row = r->second;
+        if (row.dirty)
+        {
+            // the index is updated only after the record has been written, so an I/O error leaves the row resident
+            auto n = static_cast<uint32_t>(row.data.size());
+            auto s = spilled.find(r->first);
+            auto ext = (s != spilled.end()) ? s->second : extent_type{};
+            auto old_capacity = ext.capacity;
+            bool append = n > ext.capacity;
+            if (append)
+            {
+                ext.offset = file_end;
+                ext.capacity = record_capacity(n);
+            }
+            ext.count = n;
+            write_at(ext.offset, encode(r->first, row.data));
+            if (append)
+            {
+                dead_bytes += old_capacity ? record_bytes(old_capacity) : 0;
+                file_end += record_bytes(ext.capacity);
+            }
+            spilled[r->first] = ext;
+        }
+        resident_cells -= row.data.size();
+        ++counters.evictions;
+        rows.erase(r);
+    }
+
+    /**
+     * @brief Serializes a row into the record format.
+     * @param i - Row index.
+     * @param data - Row cells.
+     * @returns Record bytes.
+     */
+    static std::vector<char> encode(int i, const typename SparseVector<V, def_val>::vector_data_type &data)
+    {
+        std::vector<char> buf(record_bytes(data.size()));
+        auto p = buf.data();
+        put(p, static_cast<int32_t>(i));
+        put(p, static_cast<uint32_t>(data.size()));
+        for (auto &c : data)
+        {
+            put(p, static_cast<int32_t>(c.first));
+            put(p, c.second);
+        }
+        return buf;
+    }
+
+    /**
+     * @brief Deserializes a record.
+     * @param p - Record bytes.
+     * @param data [out] Row cells. Record cells are sorted, so each one is inserted at the end in constant time.
+     * @returns Record row index.
+     */
+    template <typename Container>
+    static int decode(const char *p, Container &data)
+    {
+        auto i = get<int32_t>(p);
+        auto n = get<uint32_t>(p);
+        for (uint32_t k = 0; k < n; ++k)
+        {
+            auto j = get<int32_t>(p);
+            auto v = get<V>(p);
+            if constexpr (std::is_same<Container, std::vector<cell_type>>::value)
+                data.emplace_back(j, v);
+            else
+                data.emplace_hint(data.end(), j, v);
+        }
+        return i;
+    }
+
+    /** @brief Copies a value to the buffer and advances the buffer pointer. */
+    template <typename T>
+    static void put(char *&p, const T &v)
+    {
+        std::copy_n(reinterpret_cast<const char *>(&v), sizeof(T), p);
+        p += sizeof(T);
+    }
+
+    /** @brief Copies a value from the buffer and advances the buffer pointer. */
+    template <typename T>
+    static T get(const char *&p)
+    {
+        T v;
+        std::copy_n(p, sizeof(T), reinterpret_cast<char *>(&v));
+        p += sizeof(T);
+        return v;
+    }
+
+    /**
+     * @brief Reads the spill file.
+     * @throws std::runtime_error on I/O error. The stream state is cleared, so the next I/O operations are not affected.
+     */
+    void read_at(std::streamoff offset, std::vector<char> &buf)
+    {
+        file.clear();
+        file.seekg(offset);
+        file.read(buf.data(), buf.size());
+        if (!file)
+        {
+            file.clear();
+            throw std::runtime_error("OocSparseMatrix: spill file read error");
+        }
+        ++counters.reads;
+        counters.bytes_read += buf.size();
+    }
+
+    /**
+     * @brief Writes the spill file.
+     * @throws std::runtime_error on I/O error. The stream state is cleared, so the next I/O operations are not affected.
+     */
+    void write_at(std::streamoff offset, const std::vector<char> &buf)
+    {
+        file.clear();
+        file.seekp(offset);
+        file.write(buf.data(), buf.size());
+        if (!file)
+        {
+            file.clear();
+            throw std::runtime_error("OocSparseMatrix: spill file write error");
+        }
+        ++counters.writes;
+        counters.bytes_written += buf.size();
+    }
+
+    /**
+     * @brief Loads spilled rows following the row `i` into the read-ahead buffer.
+     * @param i - Row the iteration enters.
+     * @details Does nothing if the row is resident or already prefetched. Otherwise reads the row and up to
+     * `prefetch_depth - 1` next spilled rows; the records adjacent in the file are read with a single read.\n
+     * The read-ahead takes at most a half of the budget; resident rows are evicted to make room for it beforehand.
+     */
+    void prefetch(int i)
+    {
+        if (!prefetch_depth || rows.count(i) || readahead.count(i))
+            return;
+        readahead.clear();
+        readahead_bytes = 0;
+
+        std::vector<std::pair<int, extent_type>> batch;
+        size_t batch_bytes = 0;
+        for (auto s = spilled.lower_bound(i); s != spilled.end() && batch.size() < prefetch_depth; ++s)
+        {
+            if (rows.count(s->first))
+                continue;
+            auto bytes = readahead_row_bytes + s->second.count * sizeof(cell_type);
+            if (batch_bytes + bytes > budget_bytes / 2)
+                break;
+            batch.emplace_back(s->first, s->second);
+            batch_bytes += bytes;
+        }
+        if (batch.empty())
+            return;
+        enforce_budget(std::nullopt, batch_bytes);
+        // making room may have compacted the file and moved the records
+        for (auto &b : batch)
+            b.second = spilled[b.first];
+        std::sort(batch.begin(), batch.end(), [](auto &a, auto &b)
+                  { return a.second.offset < b.second.offset; });
+
+        for (size_t first = 0; first < batch.size();)
+        {
+            auto last = first;
+            auto run_end = batch[first].second.offset + static_cast<std::streamoff>(record_bytes(batch[first].second.capacity));
+            while (last + 1 < batch.size() && batch[last + 1].second.offset == run_end)
+            {
+                ++last;
+                run_end += record_bytes(batch[last].second.capacity);
+            }
+            auto run_begin = batch[first].second.offset;
+            // the last record needs no room beyond its cells
+            auto tail = record_bytes(batch[last].second.capacity) - record_bytes(batch[last].second.count);
+            std::vector<char> buf(static_cast<size_t>(run_end - run_begin) - tail);
+            read_at(run_begin, buf);
+            for (auto k = first; k <= last; ++k)
+            {
+                auto &cells = readahead[batch[k].first];
+                decode(buf.data() + (batch[k].second.offset - run_begin), cells);
+                readahead_bytes += readahead_row_bytes + cells.size() * sizeof(cell_type);
+            }
+            first = last + 1;
+        }
+    }
+
+    /** @brief Returns the first non-empty row index, if any. */
+    std::optional<int> first_row() const
+    {
+        return nearest_row(rows.begin(), spilled.begin());
+    }
+
+    /** @brief Returns the next non-empty row index after `i`, if any. */
+    std::optional<int> next_row(int i) const
+    {
+        return nearest_row(rows.upper_bound(i), spilled.upper_bound(i));
+    }
+
+    /** @brief Returns the lesser row index of a resident and a spilled row positions, if any. */
+    std::optional<int> nearest_row(typename rows_type::const_iterator ri,
+                                   typename std::map<int, extent_type>::const_iterator si) const
+    {
+        if (ri == rows.end())
+            return (si != spilled.end()) ? std::optional<int>(si->first) : std::nullopt;
+        if (si == spilled.end())
+            return ri->first;
+        return std::min(ri->first, si->first);
+    }
+
+    /**
+     * @brief Positions the iteration at the first cell of a row.
+     * @param row - Row index, or nothing for the end.
+     * @param i, j [out] Position of the first cell.
+     * @returns `false` if there is no row.
+     */
+    bool seek_row(std::optional<int> row, int &i, int &j)
+    {
+        if (!row)
+            return false;
+        prefetch(*row);
+        auto r = fetch(*row);
+        i = *row;
+        j = r->second.data.begin()->first;
+        return true;
+    }
+
+    std::string spill_path;                          ///< spill file path
+    std::fstream file;                               ///< spill file
+    size_t budget_bytes;                             ///< memory budget for resident cells
+    size_t prefetch_depth;                           ///< number of rows read ahead by the iteration
+    rows_type rows;                                  ///< resident rows
+    std::map<int, extent_type> spilled;              ///< records of spilled rows, including clean copies of resident ones
+    readahead_type readahead;                        ///< prefetched rows, not resident yet
+    size_t readahead_bytes{0};                       ///< estimated memory footprint of the read-ahead buffer
+    size_t resident_cells{0};                        ///< number of cells in resident rows
+    int cells{0};                                    ///< number of non-empty cells
+    int nonempty_rows{0};                            ///< number of non-empty rows
+    int clock_hand{INT_MIN};                         ///< CLOCK hand - row index to resume eviction scan from
+    std::optional<int> last_row;                     ///< row of the last access, to count row accesses once
+    std::streamoff file_end{0};                      ///< spill file size
+    size_t dead_bytes{0};                            ///< spill file bytes that are no longer referenced
+    stats_type counters;                             ///< I/O and hit rate counters
+};
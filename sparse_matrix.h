@@ -6,14 +6,22 @@
  * @author Vladimir Chekal
  * @date March 2023
  * @details
- * Implements SparseVector and SparseMatrix classes.\n
+ * Implements SparseVector and SparseMatrix classes, and ValueIndex - optional value-ordered index of a SparseMatrix.\n
  * SparseVector & SparseMatrix are std::map based template classes intended to store very large sparse vector/matrix
  * while storing only cell values different from the default one.
  * Cell type and a default value are template parameters.
  */
 
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <iterator>
 #include <map>
+#include <optional>
+#include <set>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 template <typename V, V def_val = 0>
 class SparseVector;
@@ -21,6 +29,8 @@ template <typename T, typename V, V def_val>
 class Proxy;
 template <typename V, V def_val = 0>
 class SparseMatrix;
+template <typename V, V def_val>
+class ValueIndex;
 
 /**
  * @brief Proxy for SparseVector & SparseMatrix objects to discer cell write or read
@@ -45,8 +55,10 @@ public:
      * @brief Consructor.
      * @param v Pointer to a storage that should be indexed.
      * @param i Index of a row in a matrix or a cell in a row.
+     * @param vi Pointer to the value index of a matrix to be updated on cell writes, or `nullptr`.
+     * @param r Index of a row the cell belongs to (for the cell proxy of a matrix with the value index).
      */
-    Proxy(storage_type *v, int i) : pd{v}, idx{i} {}
+    Proxy(storage_type *v, int i, ValueIndex<V, def_val> *vi = nullptr, int r = -1) : pd{v}, idx{i}, pvi{vi}, row{r} {}
 
     /** @brief Destructor.
      * @details Erases a row from a map in case this row have become empty after default value assignment.
@@ -73,7 +85,7 @@ public:
      */
     Proxy<V, V, def_val> operator[](int i)
     {
-        return Proxy<V, V, def_val>(&(*pd)[idx].get_data(), i);
+        return Proxy<V, V, def_val>(&(*pd)[idx].get_data(), i, pvi, idx);
     }
 
     /** @brief Cell value assignment operator for lvalue operator[].
@@ -85,6 +97,11 @@ public:
      */
     V operator=(const V &v)
     {
+        if constexpr (std::is_same<T, V>::value)
+        {
+            if (pvi) // keep the value index of a matrix in sync
+                pvi->assign(row, idx, V(*this), v);
+        }
         if (v == def_val) // putting Default value in cell
         {                 // if key 'idx' is in map, then remove it
             pd->erase(idx);
@@ -127,6 +144,10 @@ private:
     storage_type *pd{nullptr};
     /** Cell index passed to constructor by SparseVector  **/
     int idx{-1};
+    /** Value index of the owner SparseMatrix, if enabled. **/
+    ValueIndex<V, def_val> *pvi{nullptr};
+    /** Row index of the cell in the owner SparseMatrix. **/
+    int row{-1};
 };
 
 /**
@@ -268,6 +289,107 @@ private:
     vector_data_type data;
 };
 
+/**
+ * @brief Secondary index of SparseMatrix cells ordered by value.
+ *
+ * @tparam V cell type.
+ * @tparam def_val default value for cells.
+ *
+ * @details
+ * Stores non-default cells in two ordered sets: the whole matrix ordered by (value, row, column)
+ * and each row ordered by (value, column). So top-k, range-by-value and per-row top-k queries
+ * take O(log n) to find the first cell plus the time proportional to the output size.\n
+ * The index is updated by SparseMatrix on every cell write, that costs two set updates per write.
+ */
+template <typename V, V def_val>
+class ValueIndex
+{
+public:
+    /**
+     * @brief Updates index on a cell write.
+     * @param i, j - Cell indexes.
+     * @param old_v - Previous cell value (or default).
+     * @param v - New cell value (or default).
+     */
+    void assign(int i, int j, const V &old_v, const V &v)
+    {
+        if (old_v == v)
+            return;
+        if (old_v != def_val)
+        {
+            by_value.erase(std::make_tuple(old_v, i, j));
+            auto r = by_row.find(i);
+            r->second.erase(std::make_pair(old_v, j));
+            if (r->second.empty())
+                by_row.erase(r);
+        }
+        if (v != def_val)
+        {
+            by_value.emplace(v, i, j);
+            by_row[i].emplace(v, j);
+        }
+    }
+
+    /**
+     * @brief Erases all the index data.
+     */
+    void clear()
+    {
+        by_value.clear();
+        by_row.clear();
+    }
+
+    /**
+     * @brief Number of indexed cells.
+     */
+    size_t size() const { return by_value.size(); }
+
+    /**
+     * @brief Visits `k` cells with the greatest values in descending value order.
+     * @param k - Number of cells to visit.
+     * @param out - Functor called as `out(i, j, v)` for every cell.
+     */
+    template <typename Out>
+    void top_k(size_t k, Out out) const
+    {
+        for (auto it = by_value.crbegin(); it != by_value.crend() && k; ++it, --k)
+            out(std::get<1>(*it), std::get<2>(*it), std::get<0>(*it));
+    }
+
+    /**
+     * @brief Visits cells with values in range [lo, hi] in ascending value order.
+     * @param lo, hi - Value range bounds, both inclusive.
+     * @param out - Functor called as `out(i, j, v)` for every cell.
+     */
+    template <typename Out>
+    void range_by_value(const V &lo, const V &hi, Out out) const
+    {
+        for (auto it = by_value.lower_bound(std::make_tuple(lo, INT_MIN, INT_MIN));
+             it != by_value.cend() && !(hi < std::get<0>(*it)); ++it)
+            out(std::get<1>(*it), std::get<2>(*it), std::get<0>(*it));
+    }
+
+    /**
+     * @brief Visits `k` cells of a row with the greatest values in descending value order.
+     * @param i - Row index.
+     * @param k - Number of cells to visit.
+     * @param out - Functor called as `out(i, j, v)` for every cell.
+     */
+    template <typename Out>
+    void row_top_k(int i, size_t k, Out out) const
+    {
+        auto r = by_row.find(i);
+        if (r == by_row.end())
+            return;
+        for (auto it = r->second.crbegin(); it != r->second.crend() && k; ++it, --k)
+            out(i, it->second, it->first);
+    }
+
+private:
+    std::set<std::tuple<V, int, int>> by_value;        ///< all cells ordered by (value, row, column)
+    std::map<int, std::set<std::pair<V, int>>> by_row; ///< cells of each row ordered by (value, column)
+};
+
 /**
  * @brief SparseMatrix container class that stores only non-default cell values of a huge (INT_MAX x INT_MAX size) 2D matrix.
  *
@@ -281,7 +403,9 @@ private:
  * then the corresponding element **should be erased** from the map.\n
  * In contrary, when non-default value is written to a cell of an empty SparseVector, then new row is
  * inserted into map.\n
- * Row index ranges from 0 to MAX_INT.
+ * Row index ranges from 0 to MAX_INT.\n
+ * Optional ValueIndex serves top-k and range-by-value queries; once enabled it is updated on every cell write.
+ * Without the index these queries scan the matrix.
  *
  * @bug It is assumed that bracket operators after matrix variable always go in pair to access cell value, like: `v2 = mx[i][j] = v;`\n
  * If we'll need to access a row like `r = mx[i]` or `mx[i] = r`, we should implement corresponding operators - now it does not compile.
@@ -322,7 +446,7 @@ public:
      */
     Proxy<SparseVector<V, def_val>, V, def_val> operator[](int i)
     {
-        return Proxy<SparseVector<V, def_val>, V, def_val>(&data, i);
+        return Proxy<SparseVector<V, def_val>, V, def_val>(&data, i, index ? &*index : nullptr);
     }
 
     /**
@@ -331,6 +455,8 @@ public:
     void clear()
     {
         data.clear();
+        if (index)
+            index->clear();
     }
 
     /**
@@ -494,9 +620,303 @@ public:
      */
     iterator end() { return iterator(&data, -1, -1); }
 
+    /**
+     * @brief Stateful access path for the local access patterns, like nested `for i, for j` loops or stencils.
+     * @details Cursor caches the positions of the last accessed row in the matrix map and of the last accessed column
+     * in the row map. The next access starts from these positions: a nearby index is reached by a finger search that
+     * steps at most `finger_steps` map nodes forward or backward, and a missing cell is inserted with a hint,
+     * so the nearby reads and writes take amortised O(1). Big jumps fall back to a full map lookup.\n
+     * Writes through a cursor keep it valid. Any other modification of the matrix (through `operator[]` or another cursor)
+     * may invalidate it like it invalidates `std::map` iterators, so the cursor should be `reset()` afterwards.
+     */
+    class cursor
+    {
+        using vector_data_type = typename SparseVector<V, def_val>::vector_data_type;
+        using row_iterator = typename matrix_data_type::iterator;
+        using col_iterator = typename vector_data_type::iterator;
+
+        matrix_data_type *data_ptr{nullptr};                       ///< pointer to the map data of the SparseMatrix
+        std::optional<ValueIndex<V, def_val>> *index_ptr{nullptr}; ///< pointer to the value index of the SparseMatrix
+        row_iterator row;                                          ///< first row with index not less than `row_idx`
+        int row_idx{0};                                            ///< index of the last accessed row
+        bool has_row{false};                                       ///< `row` and `row_idx` hold a cached position
+        col_iterator col;                                          ///< first cell of the `row` with index not less than `col_idx`
+        int col_idx{0};                                            ///< index of the last accessed column in the `row`
+        bool has_col{false};                                       ///< `col` and `col_idx` hold a cached position
+
+        /**
+         * @brief Moves a position in a map to the first element with a key not less than `key`.
+         * @param m - Map to search in.
+         * @param it [in,out] Current position, the first element with a key not less than `from`.
+         * @param from - Key the current position has been found for.
+         * @param key - Key to find.
+         * @details Steps through at most `finger_steps` nodes in the direction of the key, then falls back to `lower_bound()`.
+         */
+        template <typename Map>
+        static void seek(Map &m, typename Map::iterator &it, int from, int key)
+        {
+            bool forward = key >= from;
+            for (int k = 0;; ++k)
+            {
+                if (forward ? (it == m.end() || it->first >= key) : (it == m.begin() || std::prev(it)->first < key))
+                    return;
+                if (k == finger_steps)
+                    break;
+                if (forward)
+                    ++it;
+                else
+                    --it;
+            }
+            it = m.lower_bound(key);
+        }
+
+        /**
+         * @brief Positions cursor at a row.
+         * @param i - Row index.
+         * @returns `true` if the row is not empty.
+         */
+        bool seek_row(int i)
+        {
+            if (!has_row || i != row_idx)
+            {
+                if (!has_row)
+                    row = data_ptr->lower_bound(i);
+                else
+                    seek(*data_ptr, row, row_idx, i);
+                row_idx = i;
+                has_row = true;
+                has_col = false;
+            }
+            return row != data_ptr->end() && row->first == i;
+        }
+
+        /**
+         * @brief Positions cursor at a column of a current row, that should be not empty.
+         * @param j - Column index.
+         * @returns `true` if the cell is not empty.
+         */
+        bool seek_col(int j)
+        {
+            auto &r = row->second.get_data();
+            if (!has_col)
+                col = r.lower_bound(j);
+            else if (j != col_idx)
+                seek(r, col, col_idx, j);
+            col_idx = j;
+            has_col = true;
+            return col != r.end() && col->first == j;
+        }
+
+    public:
+        /** @brief Maximal number of map nodes a finger search steps through before the full lookup. */
+        static constexpr int finger_steps = 8;
+
+        /**
+         * @brief Constructor.
+         * @param pm Pinter to the map data of the SparseMatrix object to access.
+         * @param pi Pointer to the value index of the SparseMatrix, that should be updated on writes if enabled.
+         */
+        explicit cursor(matrix_data_type *pm, std::optional<ValueIndex<V, def_val>> *pi = nullptr) : data_ptr{pm}, index_ptr{pi} {}
+
+        /**
+         * @brief Forgets cached positions, so the next access makes a full lookup.
+         */
+        void reset()
+        {
+            has_row = has_col = false;
+        }
+
+        /**
+         * @brief Reads cell value.
+         * @param i, j - Cell indexes.
+         * @returns Cell value or default value.
+         */
+        V get(int i, int j)
+        {
+            if (!seek_row(i) || !seek_col(j))
+                return def_val;
+            return col->second;
+        }
+
+        /**
+         * @brief Writes cell value.
+         * @param i, j - Cell indexes.
+         * @param v - Cell value. Assigning default value frees the cell and the row if it becomes empty.
+         */
+        void set(int i, int j, const V &v)
+        {
+            if (index_ptr && *index_ptr)
+                (*index_ptr)->assign(i, j, get(i, j), v);
+            if (v == def_val)
+            {
+                if (!seek_row(i) || !seek_col(j))
+                    return;
+                col = row->second.get_data().erase(col);
+                if (row->second.empty())
+                {
+                    row = data_ptr->erase(row);
+                    has_col = false;
+                }
+                return;
+            }
+
+            if (!seek_row(i))
+                row = data_ptr->emplace_hint(row, i, SparseVector<V, def_val>{});
+            if (seek_col(j))
+                col->second = v;
+            else
+                col = row->second.get_data().emplace_hint(col, j, v);
+        }
+    }; // cursor
+
+    /**
+     * @brief Returns cursor for the local access patterns.
+     * @returns Cursor with no cached position.
+     */
+    cursor get_cursor() { return cursor(&data, &index); }
+
+    /**
+     * @brief Builds the value index, so it is maintained on every cell write from now on.
+     * @details Does nothing if the index is already enabled.
+     */
+    void enable_value_index()
+    {
+        if (index)
+            return;
+        index.emplace();
+        for (auto &r : data)
+            for (auto &c : r.second.get_data())
+                index->assign(r.first, c.first, def_val, c.second);
+    }
+
+    /**
+     * @brief Drops the value index, so the cell writes do not pay for it anymore.
+     */
+    void disable_value_index() { index.reset(); }
+
+    /**
+     * @brief Denotes whether the value index is maintained.
+     */
+    bool has_value_index() const { return index.has_value(); }
+
+    /**
+     * @brief Returns cells with the greatest values.
+     * @param k - Maximal number of cells to return.
+     * @returns Cells in descending value order.
+     * @details Takes the time proportional to `k` with the value index enabled, or scans the whole matrix otherwise.
+     */
+    std::vector<ret_type> top_k(size_t k)
+    {
+        if (index)
+            return query([&](auto out)
+                         { index->top_k(k, out); });
+        std::vector<cell_key_type> top;
+        for (auto &r : data)
+            for (auto &c : r.second.get_data())
+                push_top(top, k, cell_key_type{c.second, r.first, c.first});
+        std::sort_heap(top.begin(), top.end(), std::greater<cell_key_type>());
+        return to_cells(top);
+    }
+
+    /**
+     * @brief Returns cells with values in a given range.
+     * @param lo, hi - Value range bounds, both inclusive.
+     * @returns Cells in ascending value order.
+     * @details Takes the time proportional to the output size with the value index enabled, or scans the whole matrix otherwise.
+     */
+    std::vector<ret_type> range_by_value(const V &lo, const V &hi)
+    {
+        if (index)
+            return query([&](auto out)
+                         { index->range_by_value(lo, hi, out); });
+        std::vector<cell_key_type> found;
+        for (auto &r : data)
+            for (auto &c : r.second.get_data())
+                if (!(c.second < lo) && !(hi < c.second))
+                    found.emplace_back(c.second, r.first, c.first);
+        std::sort(found.begin(), found.end());
+        return to_cells(found);
+    }
+
+    /**
+     * @brief Returns cells of a row with the greatest values.
+     * @param i - Row index.
+     * @param k - Maximal number of cells to return.
+     * @returns Cells in descending value order.
+     * @details Takes the time proportional to `k` with the value index enabled, or scans the row otherwise.
+     */
+    std::vector<ret_type> row_top_k(int i, size_t k)
+    {
+        if (index)
+            return query([&](auto out)
+                         { index->row_top_k(i, k, out); });
+        std::vector<cell_key_type> top;
+        auto r = data.find(i);
+        if (r != data.end())
+            for (auto &c : r->second.get_data())
+                push_top(top, k, cell_key_type{c.second, i, c.first});
+        std::sort_heap(top.begin(), top.end(), std::greater<cell_key_type>());
+        return to_cells(top);
+    }
+
 private:
     /**
      * @brief `std::map` container, storing non-empty rows (with non-default values). Key (type int) equals to a row index.
      */
     matrix_data_type data;
+
+    /**
+     * @brief Optional value index, maintained on cell writes when enabled.
+     */
+    std::optional<ValueIndex<V, def_val>> index;
+
+    /**
+     * @brief Cell ordering key for the queries without the value index, the same as ValueIndex uses.
+     */
+    using cell_key_type = std::tuple<V, int, int>;
+
+    /**
+     * @brief Runs a value index query. The index should be enabled.
+     * @param visit - Functor that passes the cell visitor to a ValueIndex query.
+     * @returns Cells visited by the query.
+     */
+    template <typename Visit>
+    std::vector<ret_type> query(Visit visit)
+    {
+        std::vector<ret_type> cells;
+        visit([&](int i, int j, const V &v)
+              { cells.push_back(ret_type{i, j, v}); });
+        return cells;
+    }
+
+    /**
+     * @brief Adds a cell to a min-heap of the `k` greatest cells.
+     * @param heap [in,out] Heap ordered by `std::greater`, holding at most `k` cells.
+     * @param k - Heap size limit.
+     * @param key - Cell to add.
+     */
+    static void push_top(std::vector<cell_key_type> &heap, size_t k, cell_key_type &&key)
+    {
+        heap.push_back(std::move(key));
+        std::push_heap(heap.begin(), heap.end(), std::greater<cell_key_type>());
+        if (heap.size() > k)
+        {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<cell_key_type>());
+            heap.pop_back();
+        }
+    }
+
+    /**
+     * @brief Converts cell keys to the query result.
+     * @param keys - Cell keys in the result order.
+     * @returns Cells in the same order.
+     */
+    static std::vector<ret_type> to_cells(const std::vector<cell_key_type> &keys)
+    {
+        std::vector<ret_type> cells;
+        cells.reserve(keys.size());
+        for (auto &key : keys)
+            cells.push_back(ret_type{std::get<1>(key), std::get<2>(key), std::get<0>(key)});
+        return cells;
+    }
 };
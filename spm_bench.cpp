@@ -0,0 +1,160 @@
+/**
+ * @file spm_bench.cpp
+ * @brief SparseMatrix access path benchmarks.
+ * @details
+ * Compares plain `operator[]` with SparseMatrix::cursor on row-major fill, row-major read and 5-point stencil read.\n
+ * Measures the write-path overhead of the value index and compares top-k and range-by-value queries
+ * served by the index with a full scan.\n
+ * Usage: `spm_bench [n]` - the benchmarks run on a n x n matrix with every other cell filled (default n = 1000).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+#include "sparse_matrix.h"
+
+using matrix_type = SparseMatrix<int, 0>;
+
+/**
+ * @brief Runs a function and prints its duration.
+ * @param name - Benchmark name.
+ * @param f - Function to measure, returns a checksum to keep the work from being optimized out.
+ */
+template <typename F>
+void measure(const std::string &name, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    long long checksum = f();
+    std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << ms.count() << " ms (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = (argc > 1) ? std::atoi(argv[1]) : 1000;
+    if (n <= 0)
+    {
+        std::cerr << "Usage: spm_bench [n], n > 0" << std::endl;
+        return 1;
+    }
+
+    matrix_type a, b;
+
+    measure("fill row-major, operator[]", [&]
+            {
+        for (int i = 0; i < n; ++i)
+            for (int j = i % 2; j < n; j += 2)
+                a[i][j] = i + j;
+        return static_cast<long long>(a.size()); });
+
+    measure("fill row-major, cursor    ", [&]
+            {
+        auto c = b.get_cursor();
+        for (int i = 0; i < n; ++i)
+            for (int j = i % 2; j < n; j += 2)
+                c.set(i, j, i + j);
+        return static_cast<long long>(b.size()); });
+
+    measure("read row-major, operator[]", [&]
+            {
+        long long s = 0;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                s += a[i][j];
+        return s; });
+
+    measure("read row-major, cursor    ", [&]
+            {
+        long long s = 0;
+        auto c = b.get_cursor();
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                s += c.get(i, j);
+        return s; });
+
+    measure("stencil read, operator[]  ", [&]
+            {
+        long long s = 0;
+        for (int i = 1; i < n - 1; ++i)
+            for (int j = 1; j < n - 1; ++j)
+                s += a[i][j] + a[i - 1][j] + a[i + 1][j] + a[i][j - 1] + a[i][j + 1];
+        return s; });
+
+    measure("stencil read, cursor      ", [&]
+            {
+        long long s = 0;
+        // one cursor per stencil row keeps every access next to the previous one in the same row
+        auto up = b.get_cursor(), mid = b.get_cursor(), down = b.get_cursor();
+        for (int i = 1; i < n - 1; ++i)
+            for (int j = 1; j < n - 1; ++j)
+                s += mid.get(i, j) + up.get(i - 1, j) + down.get(i + 1, j) + mid.get(i, j - 1) + mid.get(i, j + 1);
+        return s; });
+
+    matrix_type ai, bi;
+    ai.enable_value_index();
+    bi.enable_value_index();
+
+    // pseudo-random cell values in [1, 1000003], never equal to the default value 0
+    auto value = [](int i, int j)
+    {
+        return static_cast<int>((i * 7919LL + j * 104729LL) % 1000003 + 1);
+    };
+
+    measure("fill row-major, operator[], value index", [&]
+            {
+        for (int i = 0; i < n; ++i)
+            for (int j = i % 2; j < n; j += 2)
+                ai[i][j] = value(i, j);
+        return static_cast<long long>(ai.size()); });
+
+    measure("fill row-major, cursor, value index    ", [&]
+            {
+        auto c = bi.get_cursor();
+        for (int i = 0; i < n; ++i)
+            for (int j = i % 2; j < n; j += 2)
+                c.set(i, j, value(i, j));
+        return static_cast<long long>(bi.size()); });
+
+    const size_t k = 100;
+
+    measure("top 100, full scan and heap            ", [&]
+            {
+        std::priority_queue<int, std::vector<int>, std::greater<int>> heap;
+        for (auto c : ai)
+        {
+            heap.push(c.v);
+            if (heap.size() > k)
+                heap.pop();
+        }
+        return heap.empty() ? 0LL : static_cast<long long>(heap.top()); });
+
+    matrix_type an = ai;
+    an.disable_value_index();
+
+    measure("top 100, top_k without value index     ", [&]
+            {
+        auto top = an.top_k(k);
+        return top.empty() ? 0LL : static_cast<long long>(top.back().v); });
+
+    measure("top 100, value index                   ", [&]
+            {
+        auto top = ai.top_k(k);
+        return top.empty() ? 0LL : static_cast<long long>(top.back().v); });
+
+    measure("range by value, full scan              ", [&]
+            {
+        long long cnt = 0;
+        for (auto c : ai)
+            cnt += (c.v >= 500000 && c.v <= 501000);
+        return cnt; });
+
+    measure("range by value, value index            ", [&]
+            { return static_cast<long long>(ai.range_by_value(500000, 501000).size()); });
+
+    return 0;
+}